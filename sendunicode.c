@@ -70,27 +70,18 @@ static int utf8_to_unicode(const char utf8string[], int *unicode)
 	return -1;
 }
 
-// send utf-8 string to window
-void send_unicode(Display *dpy, Window target, const char *utf8string, int delay)
-{
-	// fprintf(stderr, "%s : %p 0x%lx %s\n", __func__, dpy, target, utf8string);
-
-	XEvent event = {0};
-	delay = delay / 2;      // delay 2 times after keypress and keyrelease
-
-	event.xkey.display = dpy;
-	event.xkey.window = target;
+// unused keycode found by last find_unused_keycode(), 0 if unknown
+static int unused_keycode_cache;
 
-	event.xkey.root = XDefaultRootWindow(dpy);
-	event.xkey.subwindow = None;
-	event.xkey.time = CurrentTime;
-	event.xkey.same_screen = True;
-	event.xkey.x = 1;
-	event.xkey.y = 1;
-	event.xkey.x_root = 1;
-	event.xkey.y_root = 1;
+// return keycode that has no keysym, 0 if not found
+// result is cached until keyboard mapping is changed by others,
+// to avoid XGetKeyboardMapping() round trip for every string
+static int find_unused_keycode(Display *dpy)
+{
+	if (unused_keycode_cache) {
+		return unused_keycode_cache;
+	}
 
-	// find unused keycode in keymap and bind it temporarily
 	int min_keycode, max_keycode, keysyms_per_keycode;
 	KeySym *keymap, *pkey;
 	XDisplayKeycodes(dpy, &min_keycode, &max_keycode);
@@ -99,20 +90,97 @@ void send_unicode(Display *dpy, Window target, const char *utf8string, int delay
 	                             &keysyms_per_keycode);
 	if (!keymap) {
 		fprintf(stderr, "error : XGetKeyboardMapping()\n");
-		return;
+		return 0;
 	}
 	pkey = keymap;
 	KeySym *all_zero = calloc(sizeof(KeySym), keysyms_per_keycode);
-	int unused_keycode = 0;
 	for (int i = min_keycode; i <= max_keycode; i++) {
 		if (memcmp(pkey, all_zero, keysyms_per_keycode * sizeof(KeySym)) == 0) {
-			unused_keycode = i;
+			unused_keycode_cache = i;
 			break;
 		}
 		pkey += keysyms_per_keycode;
 	}
 	free(all_zero);
 	XFree(keymap);
+	return unused_keycode_cache;
+}
+
+// number of MappingNotify caused by change_keycode() not received yet,
+// and keycode changed by it
+static int own_mapping_pending;
+static int own_mapping_keycode;
+
+// bind keysym to keycode, and count MappingNotify caused by it
+static void change_keycode(Display *dpy, int keycode, KeySym keysym)
+{
+	if (keycode != own_mapping_keycode) {
+		own_mapping_keycode = keycode;
+		own_mapping_pending = 0;
+	}
+	own_mapping_pending++;
+	XChangeKeyboardMapping(dpy, keycode, 1, &keysym, 1);
+}
+
+// forget cached unused keycode when keyboard mapping was changed by others
+// other tools (xdotool, other tkxwin) may bind the same keycode
+void send_unicode_mapping_notify(XMappingEvent *ev)
+{
+	if (ev->request != MappingKeyboard) {
+		return;
+	}
+	if ((own_mapping_pending > 0) && (ev->first_keycode == own_mapping_keycode) &&
+	    (ev->count == 1)) {
+		own_mapping_pending--;
+		return;
+	}
+	unused_keycode_cache = 0;
+}
+
+// fill common fields of key event sent to target
+static void init_key_event(Display *dpy, Window target, XEvent *event)
+{
+	event->xkey.display = dpy;
+	event->xkey.window = target;
+
+	event->xkey.root = XDefaultRootWindow(dpy);
+	event->xkey.subwindow = None;
+	event->xkey.time = CurrentTime;
+	event->xkey.same_screen = True;
+	event->xkey.x = 1;
+	event->xkey.y = 1;
+	event->xkey.x_root = 1;
+	event->xkey.y_root = 1;
+}
+
+// send one keystroke (KeyPress and KeyRelease) with modifier state to window
+void send_key(Display *dpy, Window target, int keycode, unsigned int state)
+{
+	XEvent event = {0};
+
+	init_key_event(dpy, target, &event);
+	event.xkey.keycode = keycode;
+	event.xkey.state = state;
+
+	event.xkey.type = KeyPress;
+	XSendEvent(dpy, target, True, KeyPressMask, &event);
+	event.xkey.type = KeyRelease;
+	XSendEvent(dpy, target, True, KeyReleaseMask, &event);
+	XFlush(dpy);
+}
+
+// send utf-8 string to window
+void send_unicode(Display *dpy, Window target, const char *utf8string, int delay)
+{
+	// fprintf(stderr, "%s : %p 0x%lx %s\n", __func__, dpy, target, utf8string);
+
+	XEvent event = {0};
+	delay = delay / 2;      // delay 2 times after keypress and keyrelease
+
+	init_key_event(dpy, target, &event);
+
+	// find unused keycode in keymap and bind it temporarily
+	int unused_keycode = find_unused_keycode(dpy);
 	// fprintf(stderr, "unused_keycode = %d\n", unused_keycode);
 	if (unused_keycode == 0) {
 		fprintf(stderr, "unused keycode was not found\n");
@@ -140,9 +208,10 @@ void send_unicode(Display *dpy, Window target, const char *utf8string, int delay
 		p += num_bytes;
 
 		// change keymap
-		KeySym keysym_list[] = {unicode};
-		XChangeKeyboardMapping(dpy, unused_keycode, 1, keysym_list, 1);
-		XSync(dpy, False);
+		// server changes the mapping before delivering the events below,
+		// but target fetches new mapping only after it receives MappingNotify.
+		// the delay gives target time to do it before next change
+		change_keycode(dpy, unused_keycode, unicode);
 		event.xkey.keycode = unused_keycode;
 		event.xkey.state = 0;
 
@@ -156,8 +225,6 @@ void send_unicode(Display *dpy, Window target, const char *utf8string, int delay
 		XFlush(dpy);
 		usleep(delay);
 
-		XSync(dpy, False);
-
 		// send KeyRelease
 		event.xkey.type = KeyRelease;
 		ret = XSendEvent(dpy, target, True, KeyReleaseMask, &event);
@@ -166,7 +233,6 @@ void send_unicode(Display *dpy, Window target, const char *utf8string, int delay
 		usleep(delay);
 	}
 	// restore keymap
-	KeySym keysym_list[] = {0};
-	XChangeKeyboardMapping(dpy, unused_keycode, 1, keysym_list, 1);
+	change_keycode(dpy, unused_keycode, NoSymbol);
 	XFlush(dpy);
 }
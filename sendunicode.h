@@ -1 +1,3 @@
 void send_unicode(Display *dpy, Window target, const char *utf8string, int delay);
+void send_key(Display *dpy, Window target, int keycode, unsigned int state);
+void send_unicode_mapping_notify(XMappingEvent *ev);
@@ -0,0 +1,14 @@
+lappend ::auto_path [pwd]
+package require tkxwin
+
+# about 10 kilobytes
+set text [string repeat "the quick brown fox jumps over the lazy dog\n" 250]
+
+proc pasted {fetched} {
+	puts "fetched : $fetched"
+}
+
+::tkxwin::registerHotkey Control-a {
+	::tkxwin::sendUnicode -method paste -pastekey Shift-Insert -command pasted $text
+}
+pack [label .l -text "Press Control-a key to paste [string length $text] characters to active window"]
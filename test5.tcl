@@ -0,0 +1,12 @@
+lappend ::auto_path [pwd]
+package require tkxwin
+
+set log {}
+
+::tkxwin::registerHotkey Control-a {
+	lappend log "repeatCount = $::tkxwin::repeatCount"
+	# slow script, repeats are queued while running
+	after 500
+} -repeat coalesce
+pack [label .l -text "Hold Control-a key, repeats are coalesced into one run"]
+pack [listbox .lb -listvariable log -height 10]
@@ -5,6 +5,8 @@
 #include <stdlib.h>
 
 #include <X11/Xutil.h>          // XLookupString()
+#include <X11/Xatom.h>          // XA_PRIMARY, XA_STRING
+#include <X11/XKBlib.h>         // XkbSetDetectableAutoRepeat()
 
 #include "sendunicode.h"
 
@@ -20,12 +22,9 @@ static Tcl_Obj *hotkeyInfo;
 //   value : callback name
 static Tcl_Obj *grabkeyInfo;
 
-// x error handler
-static int
-IgnoreError(Display *dpy, XErrorEvent *ev)
-{
-	return 0;
-}
+// cached modifier mapping for grabKey, NULL if not fetched yet
+// refreshed when MappingNotify is received
+static XModifierKeymap *modifierMap;
 
 static void MyEvalObjEx(Tcl_Interp *interp, Tcl_Obj *obj)
 {
@@ -37,29 +36,391 @@ static void MyEvalObjEx(Tcl_Interp *interp, Tcl_Obj *obj)
 	Tcl_DecrRefCount(obj);
 }
 
+// how repeated KeyPress of held key is delivered
+enum {
+	REPEAT_ALL,             // run for every repeat
+	REPEAT_IGNORE,          // run only for the first KeyPress
+	REPEAT_RATE,            // run at most once per interval
+	REPEAT_COALESCE,        // run once with number of repeats when events drain
+};
+
+// repeat handling of a hotkey or grabbed window
+// bindings with REPEAT_ALL have no entry
+typedef struct {
+	Tcl_Interp *interp;
+	int mode;               // REPEAT_*
+	int interval;           // msec, for REPEAT_RATE
+	Tcl_Time last;          // last time of running, for REPEAT_RATE
+	int count;              // repeats not run yet, for REPEAT_RATE and REPEAT_COALESCE
+	XEvent event;           // last repeated event, for REPEAT_COALESCE
+	int isHotkey;           // true for hotkey, false for grabbed window
+} RepeatInfo;
+
+// hash table of RepeatInfo for hotkeys
+//   key : hotkey string, same as key of hotkeyInfo
+static Tcl_HashTable hotkeyRepeat;
+
+// hash table of RepeatInfo for grabbed windows
+//   key : grabbed window
+static Tcl_HashTable grabkeyRepeat;
+
+// state of keys, to know whether KeyPress is a repeat
+// with detectable autorepeat, held key sends KeyPress without KeyRelease.
+// without it, held key sends KeyRelease and KeyPress with same time
+// times are server time of events
+static unsigned char keyDown[256];
+static Time keyDownTime[256];
+static Time keyReleaseTime[256];
+
+// true if callback of grabbed window returned false for last KeyPress of
+// the key, dropped repeats of the key are sent to the window
+static unsigned char keyPassThrough[256];
+
+// true after EnableDetectableAutoRepeat() was called
+static int detectableAutoRepeatRequested;
+// true if detectable autorepeat was enabled
+static int detectableAutoRepeat;
+// detectable autorepeat before enabling, restored on unload
+static Bool savedDetectableAutoRepeat;
+
+// msec, KeyPress of a key down longer ago than this is not a repeat.
+// KeyRelease may be lost when grab is broken, longer than usual autorepeat delay
+#define REPEAT_GAP 1000
+
+// msec elapsed from t to now
+static long ElapsedMsec(const Tcl_Time *t, const Tcl_Time *now)
+{
+	return (now->sec - t->sec) * 1000 + (now->usec - t->usec) / 1000;
+}
+
+// enable detectable autorepeat, held key sends only KeyPress,
+// so repeats can be told from new presses.
+// it affects KeyRelease of whole application, so enabled only when
+// a binding handles repeats
+static void EnableDetectableAutoRepeat(Tcl_Interp *interp)
+{
+	if (detectableAutoRepeatRequested) {
+		return;
+	}
+	Tk_Window tkwin = Tk_MainWindow(interp);
+	if (!tkwin) {
+		return;
+	}
+	detectableAutoRepeatRequested = 1;
+
+	Display *dpy = Tk_Display(tkwin);
+	Bool supported = False;
+	savedDetectableAutoRepeat = XkbGetDetectableAutoRepeat(dpy, &supported);
+	detectableAutoRepeat = supported &&
+	                       XkbSetDetectableAutoRepeat(dpy, True, &supported) && supported;
+	if (!detectableAutoRepeat) {
+		fprintf(stderr, "tkxwin : detectable autorepeat is not supported, "
+		        "repeats are detected by KeyRelease time\n");
+	}
+}
+
+// update key state and return true if eventPtr is autorepeat of held key
+// server time is used, events may be processed long after they were sent
+static int IsRepeat(XEvent *eventPtr)
+{
+	unsigned int keycode = eventPtr->xkey.keycode & 0xff;
+	Time time = eventPtr->xkey.time;
+
+	if (eventPtr->type == KeyRelease) {
+		keyDown[keycode] = 0;
+		keyReleaseTime[keycode] = time;
+		return 0;
+	}
+	int repeat = keyDown[keycode] && (time - keyDownTime[keycode] < REPEAT_GAP);
+	if (!detectableAutoRepeat && (time != CurrentTime) &&
+	    (keyReleaseTime[keycode] == time)) {
+		repeat = 1;
+	}
+	keyDown[keycode] = 1;
+	keyDownTime[keycode] = time;
+	return repeat;
+}
+
+// set ::tkxwin::repeatCount, number of repeats since last run of the binding
+static void SetRepeatCount(Tcl_Interp *interp, int count)
+{
+	Tcl_SetVar2Ex(interp, NS "::repeatCount", NULL, Tcl_NewIntObj(count), TCL_GLOBAL_ONLY);
+}
+
+// run hotkey script
+static void RunHotkey(Tcl_Interp *interp, Tcl_Obj *scriptObj, int count)
+{
+	SetRepeatCount(interp, count);
+	MyEvalObjEx(interp, scriptObj);
+}
+
+// run callback of grabbed window
+// send original event to the window if callback returns false
+static void RunGrabCallback(Tcl_Interp *interp, Tcl_Obj *objProcname, XEvent *eventPtr, int count)
+{
+#define STRSIZE 1000
+	KeySym ks;
+	char str[STRSIZE + 1];
+	int nbytes;
+	// return number of characters bytes
+	nbytes = XLookupString(&eventPtr->xkey, str, STRSIZE, &ks, NULL);
+	// get keysym name
+	char *symstr = XKeysymToString(ks);
+	// fprintf(stderr, "symstr=%s\n", symstr);
+
+	// str is not null-terminated ?
+	str[nbytes] = '\0';
+
+	// fprintf(stderr,
+	//         "GenericProc : state=0x%x, keycode=0x%x, keysym=0x%lx, str=%s, nbytes=%d\n",
+	//         eventPtr->xkey.state, eventPtr->xkey.keycode, ks, str,
+	//         nbytes);
+
+	Tcl_Obj *callback_result;
+	int callback_return = 1; // initially, set 1 (true)
+	// exec callback proc
+	if (ks != NoSymbol) {
+		// create script string
+		Tcl_Obj *script = Tcl_NewObj();
+		Tcl_IncrRefCount(script);
+		// use Tcl_ListObjAppendList() to escape characters like \ { } [ ].
+		// symstr or str may contain those characters.
+		Tcl_ListObjAppendList(interp, script, objProcname);
+		Tcl_ListObjAppendElement(interp, script, Tcl_NewIntObj(eventPtr->xkey.window));
+		Tcl_ListObjAppendElement(interp, script, Tcl_NewIntObj(eventPtr->xkey.state));
+		Tcl_ListObjAppendElement(interp, script, Tcl_NewIntObj(eventPtr->xkey.keycode));
+		Tcl_ListObjAppendElement(interp, script, Tcl_NewStringObj(symstr, -1));
+		Tcl_ListObjAppendElement(interp, script, Tcl_NewStringObj(str, -1));
+		SetRepeatCount(interp, count);
+		// fprintf(stderr, "script=%s\n", Tcl_GetString(script));
+		MyEvalObjEx(interp, script);
+		Tcl_DecrRefCount(script);
+
+		// if result is not true value, send original event to target
+		callback_result = Tcl_GetObjResult(interp);
+		Tcl_IncrRefCount(callback_result);
+		// fprintf(stderr, "GenericProc : callback_result : %s\n", Tcl_GetString(callback_result));
+		Tcl_GetBooleanFromObj(interp, callback_result, &callback_return);
+		Tcl_DecrRefCount(callback_result);
+
+	}
+	int passThrough = (ks == NoSymbol) || !callback_return;
+	keyPassThrough[eventPtr->xkey.keycode & 0xff] = passThrough;
+	if (passThrough) {
+		// send original event
+		XSendEvent(eventPtr->xkey.display, eventPtr->xkey.window,
+		           True, KeyPressMask, eventPtr);
+	}
+}
+
+// idle callback, run coalesced repeats once events are drained
+static void CoalescedRepeatProc(ClientData clientData)
+{
+	RepeatInfo *info = clientData;
+	Tcl_Interp *interp = info->interp;
+	int count = info->count;
+	info->count = 0;
+	// callback may free info by ungrabKey or unregisterHotkey
+	XEvent event = info->event;
+
+	if (info->isHotkey) {
+		Tcl_Obj *keyObj = Tcl_ObjPrintf("%d+%d", event.xkey.keycode,
+		                                event.xkey.state);
+		Tcl_Obj *scriptObj;
+		Tcl_IncrRefCount(keyObj);
+		Tcl_DictObjGet(interp, hotkeyInfo, keyObj, &scriptObj);
+		Tcl_DecrRefCount(keyObj);
+		if (scriptObj) {
+			RunHotkey(interp, scriptObj, count);
+		}
+	} else {
+		Tcl_Obj *objWinid = Tcl_NewIntObj(event.xkey.window);
+		Tcl_Obj *objProcname;
+		Tcl_IncrRefCount(objWinid);
+		Tcl_DictObjGet(interp, grabkeyInfo, objWinid, &objProcname);
+		Tcl_DecrRefCount(objWinid);
+		if (objProcname) {
+			RunGrabCallback(interp, objProcname, &event, count);
+		}
+	}
+}
+
+// decide whether KeyPress is delivered now
+// info : repeat handling of the binding, NULL for REPEAT_ALL
+// count : set number of repeats since last run of the binding
+// return true if event should be delivered now
+static int FilterRepeat(RepeatInfo *info, int repeat, XEvent *eventPtr, int *count)
+{
+	*count = repeat ? 1 : 0;
+	if (!info) {
+		return 1;
+	}
+	Tcl_Time now;
+	Tcl_GetTime(&now);
+
+	switch (info->mode) {
+	case REPEAT_IGNORE:
+		*count = 0;
+		return !repeat;
+	case REPEAT_RATE:
+		if (!repeat) {
+			info->count = 0;
+		} else if (ElapsedMsec(&info->last, &now) < info->interval) {
+			info->count++;
+			return 0;
+		} else {
+			*count = info->count + 1;
+			info->count = 0;
+		}
+		info->last = now;
+		return 1;
+	case REPEAT_COALESCE:
+		if (!repeat) {
+			return 1;
+		}
+		info->event = *eventPtr;
+		if (info->count++ == 0) {
+			Tcl_DoWhenIdle(CoalescedRepeatProc, info);
+		}
+		return 0;
+	}
+	return 1;
+}
+
+// find repeat handling of hotkey or grabbed window, NULL if not set
+static RepeatInfo *FindRepeatInfo(Tcl_HashTable *table, const void *key)
+{
+	Tcl_HashEntry *entry = Tcl_FindHashEntry(table, key);
+	if (!entry) {
+		return NULL;
+	}
+	return Tcl_GetHashValue(entry);
+}
+
+// remove repeat handling of hotkey or grabbed window
+static void RemoveRepeatInfo(Tcl_HashTable *table, const void *key)
+{
+	Tcl_HashEntry *entry = Tcl_FindHashEntry(table, key);
+	if (!entry) {
+		return;
+	}
+	RepeatInfo *info = Tcl_GetHashValue(entry);
+	Tcl_CancelIdleCall(CoalescedRepeatProc, info);
+	ckfree(info);
+	Tcl_DeleteHashEntry(entry);
+}
+
+// set repeat handling of hotkey or grabbed window
+static void SetRepeatInfo(Tcl_Interp *interp, Tcl_HashTable *table, const void *key,
+                          int isHotkey, int mode, int interval)
+{
+	RemoveRepeatInfo(table, key);
+	if (mode == REPEAT_ALL) {
+		return;
+	}
+	RepeatInfo *info = (RepeatInfo *)ckalloc(sizeof(RepeatInfo));
+	memset(info, 0, sizeof(RepeatInfo));
+	info->interp = interp;
+	info->mode = mode;
+	info->interval = interval;
+	info->isHotkey = isHotkey;
+
+	int isNew;
+	Tcl_HashEntry *entry = Tcl_CreateHashEntry(table, key, &isNew);
+	Tcl_SetHashValue(entry, info);
+
+	EnableDetectableAutoRepeat(interp);
+}
+
+// parse "?-repeat mode? ?-interval msec?" options
+static int GetRepeatOptions(Tcl_Interp *interp, int objc, Tcl_Obj *const objv[],
+                            int *mode, int *interval)
+{
+	*mode = REPEAT_ALL;
+	*interval = 100;
+
+	for (int i = 0; i < objc; i += 2) {
+		const char *arg = Tcl_GetString(objv[i]);
+		if (strcmp(arg, "-repeat") == 0) {
+			const char *modestr = Tcl_GetString(objv[i + 1]);
+			if (strcmp(modestr, "all") == 0) {
+				*mode = REPEAT_ALL;
+			} else if (strcmp(modestr, "ignore") == 0) {
+				*mode = REPEAT_IGNORE;
+			} else if (strcmp(modestr, "rate") == 0) {
+				*mode = REPEAT_RATE;
+			} else if (strcmp(modestr, "coalesce") == 0) {
+				*mode = REPEAT_COALESCE;
+			} else {
+				Tcl_SetObjResult(interp, Tcl_ObjPrintf(
+					                 "bad repeat mode \"%s\": must be all, ignore, rate, or coalesce",
+					                 modestr));
+				return TCL_ERROR;
+			}
+		} else if (strcmp(arg, "-interval") == 0) {
+			if (Tcl_GetIntFromObj(interp, objv[i + 1], interval) == TCL_ERROR) {
+				return TCL_ERROR;
+			}
+			if (*interval <= 0) {
+				Tcl_SetObjResult(interp, Tcl_ObjPrintf(
+					                 "bad interval \"%s\": must be positive",
+					                 Tcl_GetString(objv[i + 1])));
+				return TCL_ERROR;
+			}
+		} else {
+			Tcl_SetObjResult(interp, Tcl_ObjPrintf(
+				                 "unknown option \"%s\"", arg));
+			Tcl_SetErrorCode(interp, "TK", "LOOKUP", "OPTION", arg, NULL);
+			return TCL_ERROR;
+		}
+	}
+	return TCL_OK;
+}
+
 // callback
 // handle KeyPress events that caused by registerHotkey or grabKey
 static int GenericProc(ClientData clientData, XEvent *eventPtr)
 {
 	Tcl_Interp *interp = clientData;
+	if (eventPtr->type == MappingNotify) {
+		// forget cached mappings, tk also handles this event
+		if ((eventPtr->xmapping.request == MappingModifier) && modifierMap) {
+			XFreeModifiermap(modifierMap);
+			modifierMap = NULL;
+		}
+		send_unicode_mapping_notify(&eventPtr->xmapping);
+		return 0;
+	}
+	if (eventPtr->type == KeyRelease) {
+		IsRepeat(eventPtr);
+		return 0;
+	}
 	if ((eventPtr->type == KeyPress)) {
 
 		Tk_Window tkwin = Tk_MainWindow(interp);
 		Display *dpy = Tk_Display(tkwin);
 		Window root = DefaultRootWindow(dpy);
+		int repeat = IsRepeat(eventPtr);
+		int count;
 
 		Tcl_Obj *keyObj = Tcl_ObjPrintf("%d+%d",
 		                                eventPtr->xkey.keycode,
 		                                eventPtr->xkey.state);
+		Tcl_IncrRefCount(keyObj);
 		// fprintf(stderr, "GenericProc : KeyPress : %s\n", Tcl_GetString(key));
 		Tcl_Obj *scriptObj;
 		Tcl_DictObjGet(interp, hotkeyInfo, keyObj, &scriptObj);
 		if (scriptObj && eventPtr->xkey.window == root) {
 			// called by hotkey
 			// run registered script
-			MyEvalObjEx(interp, scriptObj);
+			RepeatInfo *info = FindRepeatInfo(&hotkeyRepeat, Tcl_GetString(keyObj));
+			Tcl_DecrRefCount(keyObj);
+			if (FilterRepeat(info, repeat, eventPtr, &count)) {
+				RunHotkey(interp, scriptObj, count);
+			}
 			return 1;
 		} else {
+			Tcl_DecrRefCount(keyObj);
 			Tcl_Obj *objWinid = Tcl_NewIntObj(eventPtr->xkey.window);
 			Tcl_Obj *objProcname;
 			Tcl_IncrRefCount(objWinid);
@@ -71,55 +432,13 @@ static int GenericProc(ClientData clientData, XEvent *eventPtr)
 			}
 
 			// called from grabbed window
-#define STRSIZE 1000
-			KeySym ks;
-			char str[STRSIZE + 1];
-			int nbytes;
-			// return number of characters bytes
-			nbytes = XLookupString(&eventPtr->xkey, str, STRSIZE, &ks, NULL);
-			// get keysym name
-			char *symstr = XKeysymToString(ks);
-			// fprintf(stderr, "symstr=%s\n", symstr);
-
-			// str is not null-terminated ?
-			str[nbytes] = '\0';
-
-			// fprintf(stderr,
-			//         "GenericProc : state=0x%x, keycode=0x%x, keysym=0x%lx, str=%s, nbytes=%d\n",
-			//         eventPtr->xkey.state, eventPtr->xkey.keycode, ks, str,
-			//         nbytes);
-
-			Tcl_Obj *callback_result;
-			int callback_return = 1; // initially, set 1 (true)
-			// exec callback proc
-			if (ks != NoSymbol) {
-				// create script string
-				Tcl_Obj *script = Tcl_NewObj();
-				Tcl_IncrRefCount(script);
-				// use Tcl_ListObjAppendList() to escape characters like \ { } [ ].
-				// symstr or str may contain those characters.
-				Tcl_ListObjAppendList(interp, script, objProcname);
-				Tcl_ListObjAppendElement(interp, script, Tcl_NewIntObj(eventPtr->xkey.window));
-				Tcl_ListObjAppendElement(interp, script, Tcl_NewIntObj(eventPtr->xkey.state));
-				Tcl_ListObjAppendElement(interp, script, Tcl_NewIntObj(eventPtr->xkey.keycode));
-				Tcl_ListObjAppendElement(interp, script, Tcl_NewStringObj(symstr, -1));
-				Tcl_ListObjAppendElement(interp, script, Tcl_NewStringObj(str, -1));
-				// fprintf(stderr, "script=%s\n", Tcl_GetString(script));
-				MyEvalObjEx(interp, script);
-				Tcl_DecrRefCount(script);
-
-				// if result is not true value, send original event to target
-				callback_result = Tcl_GetObjResult(interp);
-				Tcl_IncrRefCount(callback_result);
-				// fprintf(stderr, "GenericProc : callback_result : %s\n", Tcl_GetString(callback_result));
-				Tcl_GetBooleanFromObj(interp, callback_result, &callback_return);
-				Tcl_DecrRefCount(callback_result);
-
-			}
-			if ((ks == NoSymbol) || !callback_return) {
-				// send original event
+			RepeatInfo *info = FindRepeatInfo(&grabkeyRepeat, (void *)eventPtr->xkey.window);
+			if (info && repeat && keyPassThrough[eventPtr->xkey.keycode & 0xff]) {
+				// callback passed the key through, let it repeat in the window
 				XSendEvent(eventPtr->xkey.display, eventPtr->xkey.window,
 				           True, KeyPressMask, eventPtr);
+			} else if (FilterRepeat(info, repeat, eventPtr, &count)) {
+				RunGrabCallback(interp, objProcname, eventPtr, count);
 			}
 			return 1;
 		}
@@ -131,7 +450,7 @@ static int GenericProc(ClientData clientData, XEvent *eventPtr)
 // register hotkey
 // append to hotkeyInfo
 static int AppendHotkey(Tcl_Interp *interp, int keycode, unsigned int modifiers,
-                        Tcl_Obj *script)
+                        Tcl_Obj *script, int repeatMode, int repeatInterval)
 {
 	Tk_Window tkwin = Tk_MainWindow(interp);
 	if (!tkwin) {
@@ -153,6 +472,7 @@ static int AppendHotkey(Tcl_Interp *interp, int keycode, unsigned int modifiers,
 	if (ret == TCL_ERROR) {
 		return TCL_ERROR;
 	}
+	SetRepeatInfo(interp, &hotkeyRepeat, Tcl_GetString(key), 1, repeatMode, repeatInterval);
 
 	return TCL_OK;
 }
@@ -176,6 +496,7 @@ static int RemoveHotkey(Tcl_Interp *interp, int keycode, unsigned int modifiers)
 
 	// no error even if key did not exist
 	Tcl_Obj *key = Tcl_ObjPrintf("%d+%d", keycode, modifiers);
+	RemoveRepeatInfo(&hotkeyRepeat, Tcl_GetString(key));
 	int ret = Tcl_DictObjRemove(interp, hotkeyInfo, key);
 	if (ret == TCL_ERROR) {
 		return TCL_ERROR;
@@ -246,12 +567,16 @@ static int GrabKeyCmd(ClientData clientdata,
 	Display *dpy;
 	dpy = Tk_Display(tkwin);
 
-	if (objc != 3) {
-		Tcl_WrongNumArgs(interp, 1, objv, "windowid procName");
+	if ((objc < 3) || (objc % 2 == 0)) {
+		Tcl_WrongNumArgs(interp, 1, objv, "windowid procName ?-repeat mode? ?-interval msec?");
+		return TCL_ERROR;
+	}
+	int repeatMode, repeatInterval;
+	if (GetRepeatOptions(interp, objc - 3, objv + 3, &repeatMode, &repeatInterval) == TCL_ERROR) {
 		return TCL_ERROR;
 	}
 
-	Window win;
+	Window win = 0;
 	Tcl_GetIntFromObj(interp, objv[1], (int*)&win);
 
 	// update grabkeyInfo
@@ -259,26 +584,32 @@ static int GrabKeyCmd(ClientData clientdata,
 	if (ret == TCL_ERROR) {
 		return TCL_ERROR;
 	}
+	SetRepeatInfo(interp, &grabkeyRepeat, (void *)win, 0, repeatMode, repeatInterval);
 
 	// fprintf(stderr, "grabKeyCmd : win=%lx grabkeyInfo={%s}\n", win, Tcl_GetString(grabkeyInfo));
 
-	XErrorHandler handler = XSetErrorHandler(IgnoreError); // ignore BadWindow error
+	// ignore errors like BadWindow
+	// tk's error handler catches errors of these requests when they arrive,
+	// so no round trip to wait for them
+	Tk_ErrorHandler handler = Tk_CreateErrorHandler(dpy, -1, -1, -1, NULL, NULL);
+
 	// grab any keyboard keys
 	XGrabKey(dpy, AnyKey, AnyModifier, win, False, GrabModeAsync, GrabModeAsync);
-	XSync(dpy, False);         // necessary
-	XSetErrorHandler(handler); // restore error handler
 
 	// ungrab modifier keys
-	XModifierKeymap *map;
-	map = XGetModifierMapping(dpy);
+	if (!modifierMap) {
+		modifierMap = XGetModifierMapping(dpy);
+	}
 	// 8 : "Shift", "Lock", "Control", "Mod1", "Mod2", "Mod3", "Mod4", "Mod5"
-	for (int i = 0; i < 8 * map->max_keypermod; i++) {
+	for (int i = 0; i < 8 * modifierMap->max_keypermod; i++) {
 		// ignore keycode zero
-		if (map->modifiermap[i] != 0) {
-			XUngrabKey(dpy, map->modifiermap[i], 0, win);
+		if (modifierMap->modifiermap[i] != 0) {
+			XUngrabKey(dpy, modifierMap->modifiermap[i], 0, win);
 		}
 	}
-	XFreeModifiermap(map);
+
+	Tk_DeleteErrorHandler(handler);
+	XFlush(dpy);
 
 	return TCL_OK;
 }
@@ -302,18 +633,19 @@ static int UngrabKeyCmd(ClientData clientdata,
 		return TCL_ERROR;
 	}
 
-	Window win;
+	Window win = 0;
 	Tcl_GetIntFromObj(interp, objv[1], (int*)&win);
 
 	Tcl_DictObjRemove(interp, grabkeyInfo, objv[1]);
+	RemoveRepeatInfo(&grabkeyRepeat, (void *)win);
 
 	// fprintf(stderr, "UngrabKeyCmd : win=%lx grabkeyInfo={%s}\n", win, Tcl_GetString(grabkeyInfo));
 
 	// ungrab all key
-	XErrorHandler handler = XSetErrorHandler(IgnoreError); // ignore BadWindow error
+	Tk_ErrorHandler handler = Tk_CreateErrorHandler(dpy, -1, -1, -1, NULL, NULL); // ignore BadWindow error
 	XUngrabKey(dpy, AnyKey, AnyModifier, win);
-	XSync(dpy, False);         // necessary
-	XSetErrorHandler(handler); // restore error handler
+	Tk_DeleteErrorHandler(handler);
+	XFlush(dpy);
 
 	return TCL_OK;
 }
@@ -385,8 +717,12 @@ static int GetKeycodeFromKeystr(Tcl_Interp *interp, const char *keystr, int *key
 static int RegisterHotkeyCmd(ClientData clientData,
                              Tcl_Interp *interp, int objc, Tcl_Obj *const objv[])
 {
-	if (objc != 3) {
-		Tcl_WrongNumArgs(interp, 1, objv, "key script");
+	if ((objc < 3) || (objc % 2 == 0)) {
+		Tcl_WrongNumArgs(interp, 1, objv, "key script ?-repeat mode? ?-interval msec?");
+		return TCL_ERROR;
+	}
+	int repeatMode, repeatInterval;
+	if (GetRepeatOptions(interp, objc - 3, objv + 3, &repeatMode, &repeatInterval) == TCL_ERROR) {
 		return TCL_ERROR;
 	}
 	int keycode;
@@ -418,7 +754,7 @@ static int RegisterHotkeyCmd(ClientData clientData,
 		return TCL_ERROR;
 	}
 
-	if (AppendHotkey(interp, keycode, modifiers, objv[2]) == TCL_ERROR) {
+	if (AppendHotkey(interp, keycode, modifiers, objv[2], repeatMode, repeatInterval) == TCL_ERROR) {
 		return TCL_ERROR;
 	}
 
@@ -448,6 +784,216 @@ static int UnregisterHotkeyCmd(ClientData clientData,
 	return TCL_OK;
 }
 
+// selection served by sendUnicode -method paste
+// one for each selection, owned by main window
+typedef struct {
+	char *data;             // utf-8 string to serve, NULL if none
+	int length;             // bytes of data
+	int owned;              // true while main window owns the selection
+	int fetched;            // number of transfers of whole data
+} PasteSelection;
+
+static PasteSelection clipboardPaste;
+static PasteSelection primaryPaste;
+
+// previous content restored by timer after paste
+typedef struct {
+	Tcl_Interp *interp;
+	PasteSelection *sel;
+	Atom selection;
+	int hadPrev;            // false if selection had no owner
+	Tcl_DString prev;       // previous content as text
+	Tcl_Obj *command;       // called with fetched flag after restore, NULL if none
+} PasteRestore;
+
+// restore of the paste in progress, NULL if none
+// another paste is refused until it is restored
+static PasteRestore *pasteRestore;
+static Tcl_TimerToken pasteRestoreTimer;
+
+// selection handler, called by tk for each chunk of data
+// tk uses INCR transfer if data is larger than a single request
+static int PasteSelProc(ClientData clientData, int offset, char *buffer, int maxBytes)
+{
+	PasteSelection *sel = clientData;
+	if (!sel->data || offset >= sel->length) {
+		sel->fetched++;
+		return 0;
+	}
+	int count = sel->length - offset;
+	if (count > maxBytes) {
+		count = maxBytes;
+	}
+	memcpy(buffer, sel->data + offset, count);
+	if (count < maxBytes) {
+		// last chunk
+		sel->fetched++;
+	}
+	return count;
+}
+
+// called when other window takes the selection
+static void LostPasteSelProc(ClientData clientData)
+{
+	PasteSelection *sel = clientData;
+	sel->owned = 0;
+}
+
+// append retrieved selection to Tcl_DString
+static int AppendSelProc(ClientData clientData, Tcl_Interp *interp, const char *portion)
+{
+	Tcl_DStringAppend(clientData, portion, -1);
+	return TCL_OK;
+}
+
+// replace served data of sel, data is copied
+static void SetPasteData(PasteSelection *sel, const char *data, int length)
+{
+	free(sel->data);
+	sel->data = NULL;
+	sel->length = 0;
+	if (data) {
+		sel->data = malloc(length + 1);
+		memcpy(sel->data, data, length);
+		sel->data[length] = '\0';
+		sel->length = length;
+	}
+}
+
+// free restore of paste
+static void FreePasteRestore(PasteRestore *restore)
+{
+	Tcl_DStringFree(&restore->prev);
+	if (restore->command) {
+		Tcl_DecrRefCount(restore->command);
+	}
+	Tcl_Release(restore->interp);
+	ckfree(restore);
+}
+
+// timer callback, serve previous content again after paste
+static void PasteRestoreProc(ClientData clientData)
+{
+	PasteRestore *restore = clientData;
+	PasteSelection *sel = restore->sel;
+	Tcl_Interp *interp = restore->interp;
+	int fetched = sel->fetched;
+
+	pasteRestore = NULL;
+	pasteRestoreTimer = NULL;
+
+	// main window may be destroyed while waiting
+	Tk_Window tkwin = Tcl_InterpDeleted(interp) ? NULL : Tk_MainWindow(interp);
+	if (!tkwin) {
+		sel->owned = 0;
+		SetPasteData(sel, NULL, 0);
+		FreePasteRestore(restore);
+		return;
+	}
+
+	// ownership can not be given back to previous owner, so serve its content
+	if (sel->owned) {
+		if (restore->hadPrev) {
+			SetPasteData(sel, Tcl_DStringValue(&restore->prev),
+			             Tcl_DStringLength(&restore->prev));
+		} else {
+			Tk_ClearSelection(tkwin, restore->selection);
+			SetPasteData(sel, NULL, 0);
+		}
+	}
+
+	if (restore->command) {
+		Tcl_Obj *script = Tcl_DuplicateObj(restore->command);
+		Tcl_ListObjAppendElement(interp, script, Tcl_NewBooleanObj(fetched > 0));
+		MyEvalObjEx(interp, script);
+	}
+	FreePasteRestore(restore);
+}
+
+// paste utf8string to target
+// own the selection, send paste keystroke, and return.
+// the string is served for timeout msec, then the previous content is served
+// again by timer. it is served until timeout even if it was already fetched,
+// because clipboard managers fetch it as soon as ownership changes, which may
+// be before the target handles the paste keystroke.
+// command is called with true if the string was fetched by any client
+static int SendPaste(Tcl_Interp *interp, Tk_Window tkwin, Window target,
+                     const char *utf8string, const char *selname,
+                     const char *pastekey, int timeout, Tcl_Obj *command)
+{
+	Display *dpy = Tk_Display(tkwin);
+	PasteSelection *sel;
+	Atom selection;
+
+	if (strcmp(selname, "CLIPBOARD") == 0) {
+		sel = &clipboardPaste;
+		selection = Tk_InternAtom(tkwin, "CLIPBOARD");
+	} else if (strcmp(selname, "PRIMARY") == 0) {
+		sel = &primaryPaste;
+		selection = XA_PRIMARY;
+	} else {
+		Tcl_SetObjResult(interp, Tcl_ObjPrintf(
+			                 "bad selection \"%s\": must be CLIPBOARD or PRIMARY", selname));
+		return TCL_ERROR;
+	}
+
+	int keycode;
+	unsigned int modifiers;
+	if (GetKeycodeFromKeystr(interp, pastekey, &keycode, &modifiers) == TCL_ERROR) {
+		return TCL_ERROR;
+	}
+	if (keycode == 0) {
+		Tcl_SetObjResult(interp, Tcl_ObjPrintf(
+			                 "can not get keycode of \"%s\"", pastekey));
+		return TCL_ERROR;
+	}
+
+	// another paste would save our string as previous content
+	if (pasteRestore) {
+		Tcl_SetObjResult(interp, Tcl_NewStringObj("paste already in progress", -1));
+		return TCL_ERROR;
+	}
+
+	// save previous content as text
+	// refuse if the owner has no text, to not destroy content like image
+	PasteRestore *restore = (PasteRestore *)ckalloc(sizeof(PasteRestore));
+	restore->interp = interp;
+	restore->sel = sel;
+	restore->selection = selection;
+	restore->hadPrev = 0;
+	Tcl_DStringInit(&restore->prev);
+	restore->command = command;
+	if (command) {
+		Tcl_IncrRefCount(command);
+	}
+	Tcl_Preserve(interp);
+	if (XGetSelectionOwner(dpy, selection) != None) {
+		if (Tk_GetSelection(interp, tkwin, selection, XA_STRING,
+		                    AppendSelProc, &restore->prev) != TCL_OK) {
+			FreePasteRestore(restore);
+			Tcl_SetObjResult(interp, Tcl_ObjPrintf(
+				                 "can not save content of %s as text", selname));
+			return TCL_ERROR;
+		}
+		restore->hadPrev = 1;
+	}
+
+	// become owner of the selection
+	Tk_CreateSelHandler(tkwin, selection, XA_STRING, PasteSelProc, sel, XA_STRING);
+	SetPasteData(sel, utf8string, strlen(utf8string));
+	sel->fetched = 0;
+	Tk_OwnSelection(tkwin, selection, LostPasteSelProc, sel);
+	sel->owned = 1;
+
+	send_key(dpy, target, keycode, modifiers);
+
+	// serve string until timeout
+	pasteRestore = restore;
+	pasteRestoreTimer = Tcl_CreateTimerHandler(timeout, PasteRestoreProc, restore);
+
+	return TCL_OK;
+}
+
 static int SendUnicodeCmd(ClientData clientData,
                           Tcl_Interp *interp, int objc, Tcl_Obj *const objv[])
 {
@@ -455,24 +1001,42 @@ static int SendUnicodeCmd(ClientData clientData,
 
 	const char *utf8string;
 	int delay = 40000;
-
-	if (objc == 2) {
-		utf8string = Tcl_GetString(objv[1]);
-	} else if (objc == 4) {
-		const char *arg = Tcl_GetString(objv[1]);
+	const char *method = "type";
+	const char *selname = "CLIPBOARD";
+	const char *pastekey = "Control-v";
+	int timeout = 1000;
+	Tcl_Obj *command = NULL;
+
+	if ((objc < 2) || (objc % 2 != 0)) {
+		Tcl_WrongNumArgs(interp, 1, objv, "?-option value ...? string");
+		return TCL_ERROR;
+	}
+	for (int i = 1; i < objc - 1; i += 2) {
+		const char *arg = Tcl_GetString(objv[i]);
 		if (strcmp(arg, "-delay") == 0) {
-			Tcl_GetIntFromObj(interp, objv[2], &delay);
-			utf8string = Tcl_GetString(objv[3]);
+			if (Tcl_GetIntFromObj(interp, objv[i + 1], &delay) == TCL_ERROR) {
+				return TCL_ERROR;
+			}
+		} else if (strcmp(arg, "-method") == 0) {
+			method = Tcl_GetString(objv[i + 1]);
+		} else if (strcmp(arg, "-selection") == 0) {
+			selname = Tcl_GetString(objv[i + 1]);
+		} else if (strcmp(arg, "-pastekey") == 0) {
+			pastekey = Tcl_GetString(objv[i + 1]);
+		} else if (strcmp(arg, "-command") == 0) {
+			command = objv[i + 1];
+		} else if (strcmp(arg, "-timeout") == 0) {
+			if (Tcl_GetIntFromObj(interp, objv[i + 1], &timeout) == TCL_ERROR) {
+				return TCL_ERROR;
+			}
 		} else {
 			Tcl_SetObjResult(interp, Tcl_ObjPrintf(
 				                 "unknown option \"%s\"", arg));
 			Tcl_SetErrorCode(interp, "TK", "LOOKUP", "OPTION", arg, NULL);
 			return TCL_ERROR;
 		}
-	} else {
-		Tcl_WrongNumArgs(interp, 1, objv, "?-delay microsec? string");
-		return TCL_ERROR;
 	}
+	utf8string = Tcl_GetString(objv[objc - 1]);
 
 	Tk_Window tkwin;
 	tkwin = Tk_MainWindow(interp);
@@ -484,7 +1048,15 @@ static int SendUnicodeCmd(ClientData clientData,
 	Window focus;
 	focus = GetActiveWindowId(dpy);
 
-	send_unicode(dpy, focus, utf8string, delay);
+	if (strcmp(method, "type") == 0) {
+		send_unicode(dpy, focus, utf8string, delay);
+	} else if (strcmp(method, "paste") == 0) {
+		return SendPaste(interp, tkwin, focus, utf8string, selname, pastekey, timeout, command);
+	} else {
+		Tcl_SetObjResult(interp, Tcl_ObjPrintf(
+			                 "bad method \"%s\": must be type or paste", method));
+		return TCL_ERROR;
+	}
 	return TCL_OK;
 }
 
@@ -498,9 +1070,52 @@ int Tkxwin_Unload(Tcl_Interp *interp, int flags)
 	// free grabkeyInfo
 	Tcl_DecrRefCount(grabkeyInfo);
 
+	// free repeat handling
+	Tcl_HashTable *tables[] = {&hotkeyRepeat, &grabkeyRepeat};
+	for (int i = 0; i < 2; i++) {
+		Tcl_HashSearch search;
+		Tcl_HashEntry *entry;
+		for (entry = Tcl_FirstHashEntry(tables[i], &search); entry;
+		     entry = Tcl_NextHashEntry(&search)) {
+			RepeatInfo *info = Tcl_GetHashValue(entry);
+			Tcl_CancelIdleCall(CoalescedRepeatProc, info);
+			ckfree(info);
+		}
+		Tcl_DeleteHashTable(tables[i]);
+	}
+
 	// remove handler
 	Tk_DeleteGenericHandler(GenericProc, interp);
 
+	// cancel restore of sendUnicode -method paste
+	if (pasteRestore) {
+		Tcl_DeleteTimerHandler(pasteRestoreTimer);
+		FreePasteRestore(pasteRestore);
+		pasteRestore = NULL;
+		pasteRestoreTimer = NULL;
+	}
+
+	// remove selection handlers of sendUnicode -method paste
+	Tk_Window tkwin = Tk_MainWindow(interp);
+	if (tkwin) {
+		// restore detectable autorepeat, it affects KeyRelease of whole application
+		if (detectableAutoRepeat && !savedDetectableAutoRepeat) {
+			XkbSetDetectableAutoRepeat(Tk_Display(tkwin), False, NULL);
+		}
+		detectableAutoRepeatRequested = 0;
+		detectableAutoRepeat = 0;
+		Tk_DeleteSelHandler(tkwin, Tk_InternAtom(tkwin, "CLIPBOARD"), XA_STRING);
+		Tk_DeleteSelHandler(tkwin, XA_PRIMARY, XA_STRING);
+	}
+	SetPasteData(&clipboardPaste, NULL, 0);
+	SetPasteData(&primaryPaste, NULL, 0);
+
+	// free cached modifier mapping
+	if (modifierMap) {
+		XFreeModifiermap(modifierMap);
+		modifierMap = NULL;
+	}
+
 	// remove commands
 	Tcl_DeleteCommand(interp, NS "::grabKey");
 	Tcl_DeleteCommand(interp, NS "::ungrabKey");
@@ -537,6 +1152,10 @@ int Tkxwin_Init(Tcl_Interp *interp)
 	// initialize dictobj
 	hotkeyInfo = Tcl_NewDictObj();
 	grabkeyInfo = Tcl_NewDictObj();
+	Tcl_InitHashTable(&hotkeyRepeat, TCL_STRING_KEYS);
+	Tcl_InitHashTable(&grabkeyRepeat, TCL_ONE_WORD_KEYS);
+
+	SetRepeatCount(interp, 0);
 
 	// create handler
 	Tk_CreateGenericHandler(GenericProc, interp);